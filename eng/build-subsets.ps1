@@ -0,0 +1,178 @@
+<#
+.SYNOPSIS
+Computes the build subsets and packages an experiment branch needs to build.
+
+.DESCRIPTION
+Diffs the experiment branch checked out in -RepoRoot against its merge base with -BaseRef
+(runtime-main by default) and maps every changed path to build subsets of the dotnet/runtime
+build (build.sh -subset) and, for libraries, to the packages they produce.
+
+The mapping comes from -MappingFile. Its rules are tried in order and the first one matching
+a path wins. A rule path ending in '/' matches everything below that directory, any other
+path matches a single file. A '*' matches within one path component; in a rule with
+"package": true the text it matched is the name of the package to build:
+
+  { "path": "src/libraries/*/", "subsets": [ "libs" ], "package": true }
+
+Only libraries that ship a NuGet package are listed: a library counts as packable when one
+of the projects in src/libraries/<Name>/src/ on -HeadRef sets IsPackable to true. Inbox-only
+assemblies such as System.Runtime and folders that are not libraries (shims, pkg) are left
+out. The list is still an approximation: packages produced from other folders, such as the
+aggregate packages under src/libraries/*/pkg, are not detected.
+
+A rule with no subsets marks paths that do not need a build, such as documentation. A path
+that no rule matches, typically build infrastructure under eng/, selects the "full" list.
+
+Subsets that consume the output of others list them under "dependencies", and the selected
+subsets are closed over that table, so that for example a change to packaging alone also
+builds the runtime, libraries and host that go into the packages:
+
+  "dependencies": { "libs": [ "clr" ], "packs": [ "clr", "libs", "host" ] }
+
+The result is printed and set as the pipeline variables BuildSubsets ("clr.jit+libs", the
+form -subset accepts) and BuildPackages (semicolon separated), so that later steps of an
+experiment's eng/pipelines/runtimelab.yml can build just those.
+
+Experiment branches are forks of runtime-main and do not contain this script, so their
+pipeline checks out this branch of dotnet/runtimelab as a second repository next to the
+experiment, with enough experiment history to find the merge base:
+
+  resources:
+    repositories:
+    - repository: runtimelab-docs
+      type: github
+      endpoint: <GitHub service connection>
+      name: dotnet/runtimelab
+      ref: refs/heads/docs
+
+  steps:
+  - checkout: self
+    path: s/experiment
+    fetchDepth: 0
+  - checkout: runtimelab-docs
+    path: s/runtimelab-docs
+    fetchDepth: 1
+  - pwsh: |
+      git -C experiment fetch origin runtime-main
+      ./runtimelab-docs/eng/build-subsets.ps1 -RepoRoot experiment -BaseRef FETCH_HEAD
+    workingDirectory: $(Build.SourcesDirectory)
+    displayName: Compute build subsets
+#>
+[CmdletBinding(PositionalBinding=$false)]
+Param(
+  [string]$RepoRoot = ".",
+  [string]$BaseRef = "origin/runtime-main",
+  [string]$HeadRef = "HEAD",
+  [string]$MappingFile = (Join-Path $PSScriptRoot "build-subsets.json")
+)
+
+Set-StrictMode -Version 2.0
+$ErrorActionPreference = "Stop"
+
+function Invoke-Git([string[]]$Arguments) {
+  & git -C $RepoRoot @Arguments
+  if ($LASTEXITCODE -ne 0) {
+    throw "git $($Arguments -join ' ') failed with exit code $LASTEXITCODE"
+  }
+}
+
+function Test-Packable([string]$Library) {
+  # Folders without a src directory, including deleted libraries, have nothing to pack.
+  $entries = & git -C $RepoRoot ls-tree --name-only "$($HeadRef):src/libraries/$Library/src/" 2>$null
+  if ($LASTEXITCODE -ne 0) {
+    return $false
+  }
+  $projects = @($entries | Where-Object { $_ -like "*.csproj" })
+  foreach ($project in $projects) {
+    $content = Invoke-Git @("show", "$($HeadRef):src/libraries/$Library/src/$project")
+    if (($content -join "`n") -match "<IsPackable>\s*true\s*</IsPackable>") {
+      return $true
+    }
+  }
+  return $false
+}
+
+function Read-Rules {
+  $mapping = Get-Content -Raw $MappingFile | ConvertFrom-Json
+  $rules = foreach ($rule in @($mapping.rules)) {
+    # Rule paths become anchored regular expressions; the first '*' is captured for packages.
+    $pattern = "^" + (($rule.path -split '\*' | ForEach-Object { [Regex]::Escape($_) }) -join '([^/]*)')
+    if (-not $rule.path.EndsWith('/')) {
+      $pattern += '$'
+    }
+    [pscustomobject]@{
+      Path = $rule.path
+      Regex = New-Object System.Text.RegularExpressions.Regex $pattern
+      Subsets = @($rule.subsets)
+      Package = ($rule.PSObject.Properties.Name -contains "package") -and $rule.package
+    }
+  }
+  $dependencies = @{}
+  if ($mapping.PSObject.Properties.Name -contains "dependencies") {
+    foreach ($property in $mapping.dependencies.PSObject.Properties) {
+      $dependencies[$property.Name] = @($property.Value)
+    }
+  }
+  return [pscustomobject]@{ Full = @($mapping.full); Rules = @($rules); Dependencies = $dependencies }
+}
+
+$mapping = Read-Rules
+$mergeBase = Invoke-Git @("merge-base", $BaseRef, $HeadRef)
+# -z keeps paths with unusual characters intact; renames count for both their old and new path.
+$changes = @((Invoke-Git @("diff", "--name-only", "-z", "--no-renames", $mergeBase, $HeadRef)) -split "`0" | Where-Object { $_ })
+Write-Host "$($changes.Count) paths changed since merge base $mergeBase"
+
+$subsets = New-Object System.Collections.Generic.SortedSet[string]
+$packages = New-Object System.Collections.Generic.SortedSet[string]
+$packageCandidates = @{}
+foreach ($path in $changes) {
+  $rule = $null
+  foreach ($candidate in $mapping.Rules) {
+    $match = $candidate.Regex.Match($path)
+    if ($match.Success) {
+      $rule = $candidate
+      break
+    }
+  }
+
+  if ($null -eq $rule) {
+    Write-Host "  $path -> full build"
+    $mapping.Full | ForEach-Object { [void]$subsets.Add($_) }
+    continue
+  }
+  $rule.Subsets | ForEach-Object { [void]$subsets.Add($_) }
+  if ($rule.Package) {
+    $packageCandidates[$match.Groups[1].Value] = $true
+  }
+  Write-Verbose "  $path -> $($rule.Path)"
+}
+
+# Adds the subsets the selected ones depend on, and theirs in turn.
+$pending = New-Object System.Collections.Generic.Queue[string] (,[string[]]@($subsets))
+while ($pending.Count -ne 0) {
+  $subset = $pending.Dequeue()
+  if (-not $mapping.Dependencies.ContainsKey($subset)) {
+    continue
+  }
+  foreach ($dependency in $mapping.Dependencies[$subset]) {
+    if ($subsets.Add($dependency)) {
+      Write-Verbose "  $subset -> $dependency"
+      $pending.Enqueue($dependency)
+    }
+  }
+}
+
+foreach ($library in $packageCandidates.Keys) {
+  if (Test-Packable $library) {
+    [void]$packages.Add($library)
+  } else {
+    Write-Verbose "  $library does not produce a package"
+  }
+}
+
+$subsetList = @($subsets) -join '+'
+$packageList = @($packages) -join ';'
+Write-Host "Subsets: $(if ($subsetList) { $subsetList } else { '(none)' })"
+Write-Host "Packages: $(if ($packageList) { $packageList } else { '(none)' })"
+Write-Host "##vso[task.setvariable variable=BuildSubsets]$subsetList"
+Write-Host "##vso[task.setvariable variable=BuildPackages]$packageList"
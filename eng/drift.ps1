@@ -0,0 +1,161 @@
+<#
+.SYNOPSIS
+Reports how far each experiment branch has drifted from runtime-main.
+
+.DESCRIPTION
+Fetches runtime-main and every branch matching -BranchPattern (feature/* by default) from
+-RepositoryUrl into a bare repository at -CacheDirectory, and reports for each branch how
+many commits it is ahead of and behind runtime-main and where it forked (the merge base).
+Only commits are needed, so the cache is a partial clone with the tree:0 filter; with the
+commit-graph written after every fetch it stays small and fast to walk.
+
+The result of the previous run is kept next to the objects in drift.json. A branch whose tip
+and runtime-main only moved forward since then is updated from the commits that are new on
+either side, instead of walking back to the merge base again:
+
+  - commits new on runtime-main add to "behind", unless the branch already has them, in
+    which case they come off "ahead";
+  - commits new on the branch add to "ahead", unless runtime-main has them (a merge from
+    runtime-main), in which case they come off "behind".
+
+The merge base is only recomputed when commits are shared that way. Branches that are new
+or were force-pushed, or a runtime-main that was rewritten, get a full computation. The cost
+of a run therefore follows the number of new commits, not the age of the branches.
+
+The report is printed as a table and, with -ReportFile, written as JSON. The cache
+directory can be saved and restored between pipeline runs like the mirror cache:
+
+  ./eng/drift.ps1 -CacheDirectory drift.git -RepositoryUrl https://github.com/dotnet/runtimelab
+#>
+[CmdletBinding(PositionalBinding=$false)]
+Param(
+  [Parameter(Mandatory=$true)][string]$CacheDirectory,
+  [Parameter(Mandatory=$true)][string]$RepositoryUrl,
+  [string]$UpstreamBranch = "runtime-main",
+  [string]$BranchPattern = "feature/*",
+  [string]$Filter = "tree:0",
+  [string]$ReportFile = ""
+)
+
+Set-StrictMode -Version 2.0
+$ErrorActionPreference = "Stop"
+
+function Invoke-Git([string[]]$Arguments) {
+  & git --git-dir=$CacheDirectory @Arguments
+  if ($LASTEXITCODE -ne 0) {
+    throw "git $($Arguments -join ' ') failed with exit code $LASTEXITCODE"
+  }
+}
+
+function Test-Ancestor([string]$Ancestor, [string]$Descendant) {
+  # A commit that is no longer in the cache fails the check too, which falls back to a full
+  # computation for the branch.
+  & git --git-dir=$CacheDirectory merge-base --is-ancestor $Ancestor $Descendant 2>$null
+  return $LASTEXITCODE -eq 0
+}
+
+function Get-Count([string[]]$Revisions) {
+  return [int](Invoke-Git (@("rev-list", "--count") + $Revisions))
+}
+
+function Get-FullDrift([string]$Branch, [string]$Tip) {
+  $behind, $ahead = (Invoke-Git @("rev-list", "--left-right", "--count", "$upstreamTip...$Tip")) -split '\s+'
+  return [pscustomobject]@{
+    branch = $Branch
+    tip = $Tip
+    upstream = $upstreamTip
+    mergeBase = Invoke-Git @("merge-base", $upstreamTip, $Tip)
+    ahead = [int]$ahead
+    behind = [int]$behind
+  }
+}
+
+function Update-Drift($previous, [string]$Branch, [string]$Tip) {
+  if ($null -eq $previous -or -not (Test-Ancestor $previous.upstream $upstreamTip) -or -not (Test-Ancestor $previous.tip $Tip)) {
+    return Get-FullDrift $Branch $Tip
+  }
+  $drift = [pscustomobject]@{
+    branch = $Branch
+    tip = $Tip
+    upstream = $upstreamTip
+    mergeBase = $previous.mergeBase
+    ahead = $previous.ahead
+    behind = $previous.behind
+  }
+  $shared = 0
+
+  if ($previous.upstream -ne $upstreamTip) {
+    # Commits new on runtime-main, excluding those the branch had already merged.
+    $notOnBranch = Get-Count @($upstreamTip, "^$($previous.upstream)", "^$($previous.tip)")
+    $alreadyMerged = $newUpstreamCounts[$previous.upstream] - $notOnBranch
+    $drift.behind += $notOnBranch
+    $drift.ahead -= $alreadyMerged
+    $shared += $alreadyMerged
+  }
+  if ($previous.tip -ne $Tip) {
+    # Commits new on the branch, excluding those that came from runtime-main.
+    $added = Get-Count @($Tip, "^$($previous.tip)")
+    $notUpstream = Get-Count @($Tip, "^$($previous.tip)", "^$upstreamTip")
+    $drift.ahead += $notUpstream
+    $drift.behind -= $added - $notUpstream
+    $shared += $added - $notUpstream
+  }
+  if ($shared -ne 0) {
+    $drift.mergeBase = Invoke-Git @("merge-base", $upstreamTip, $Tip)
+  }
+  return $drift
+}
+
+$filterArgs = @(if ($Filter) { "--filter=$Filter" })
+$statePath = Join-Path $CacheDirectory "drift.json"
+
+if (-not (Test-Path (Join-Path $CacheDirectory "HEAD"))) {
+  Write-Host "Initializing drift cache in $CacheDirectory"
+  & git init --bare --quiet $CacheDirectory
+  if ($LASTEXITCODE -ne 0) {
+    throw "Failed to initialize drift cache in $CacheDirectory"
+  }
+}
+
+# The repository is the partial clone promisor remote, so its URL is stored in the cache
+# config and should not carry credentials.
+Invoke-Git @("config", "remote.origin.url", $RepositoryUrl)
+Invoke-Git (@("fetch", "--no-tags", "--prune") + $filterArgs + @("origin",
+  "+refs/heads/$($UpstreamBranch):refs/remotes/origin/$UpstreamBranch",
+  "+refs/heads/$($BranchPattern):refs/remotes/origin/$BranchPattern"))
+Invoke-Git @("commit-graph", "write", "--reachable", "--split")
+
+$upstreamTip = Invoke-Git @("rev-parse", "refs/remotes/origin/$UpstreamBranch")
+$previousDrift = @{}
+if (Test-Path $statePath) {
+  foreach ($entry in @(Get-Content -Raw $statePath | ConvertFrom-Json)) {
+    $previousDrift[$entry.branch] = $entry
+  }
+}
+
+# Branches usually share the previous runtime-main tip, so the commits new on runtime-main
+# are counted once per distinct previous tip rather than once per branch.
+$newUpstreamCounts = @{}
+foreach ($previous in $previousDrift.Values) {
+  if (-not $newUpstreamCounts.ContainsKey($previous.upstream) -and (Test-Ancestor $previous.upstream $upstreamTip)) {
+    $newUpstreamCounts[$previous.upstream] = Get-Count @($upstreamTip, "^$($previous.upstream)")
+  }
+}
+
+$prefix = "refs/remotes/origin/"
+$pattern = $prefix + $BranchPattern.Substring(0, $BranchPattern.LastIndexOf('/') + 1)
+$drift = foreach ($line in @(Invoke-Git @("for-each-ref", "--format=%(objectname) %(refname)", $pattern))) {
+  $tip, $ref = $line -split ' ', 2
+  $branch = $ref.Substring($prefix.Length)
+  if ($branch -notlike $BranchPattern) {
+    continue
+  }
+  Update-Drift $previousDrift[$branch] $branch $tip
+}
+$drift = @($drift | Sort-Object branch)
+
+ConvertTo-Json -InputObject $drift -Depth 3 | Set-Content -Path $statePath
+$drift | Format-Table branch, ahead, behind, mergeBase -AutoSize | Out-Host
+if ($ReportFile) {
+  ConvertTo-Json -InputObject $drift -Depth 3 | Set-Content -Path $ReportFile
+}
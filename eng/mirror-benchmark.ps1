@@ -0,0 +1,253 @@
+<#
+.SYNOPSIS
+Measures the cost of mirroring runtime to runtimelab against synthetic local repositories.
+
+.DESCRIPTION
+Generates a bare repository standing in for dotnet/runtime (source.git) and one standing in
+for dotnet/runtimelab (target.git) under -WorkDirectory. The source main branch gets -Commits
+commits touching -FilesPerCommit of -Files files; the target runtime-main branch is the same
+history without its last -NewCommits commits, which is what a mirror run has to move. The
+generator is seeded, so the same parameters always produce the same repositories.
+
+-PackLayout controls how the source objects are stored: "single" repacks everything into one
+pack, "multi" leaves one pack per tenth of the history, as an unmaintained server would.
+
+Each iteration starts from a pristine copy of target.git and runs these scenarios:
+
+  legacy  The steps of the original runtime-main-mirror.yml: clone, fetch, reset, push, and
+          the divergence check (fetch both remotes, rev-list), which the pipeline only runs
+          after a failed push.
+  cold    eng/mirror.ps1 with an empty cache.
+  warm    eng/mirror.ps1 with a cache that already holds everything except the new commits.
+  relay   eng/mirror.ps1 -Relay, which needs no cache.
+
+Every step reports wall time and, where /usr/bin/time (GNU time) is available, the peak RSS
+of the step including the git processes it starts and the bytes it read from and wrote to
+disk. The mirror.ps1 scenarios are measured as a whole in a "total (pwsh)" row, whose RSS
+and I/O include the PowerShell host and so are not comparable with the legacy git steps.
+It is followed by one row per stage from the metrics record of mirror.ps1 (fetch-source,
+fetch-target, maintenance, check, push), with its duration and the bytes it received or sent.
+Where GNU time is available mirror.ps1 runs with -MeasureGit, so these rows also carry the
+peak RSS and disk I/O of the git commands of that stage, comparable with the legacy rows.
+Results are printed as a table and written as JSON to -OutputFile if given:
+
+  ./eng/mirror-benchmark.ps1 -WorkDirectory /tmp/mirror-bench -Commits 20000 -Files 5000
+#>
+[CmdletBinding(PositionalBinding=$false)]
+Param(
+  [Parameter(Mandatory=$true)][string]$WorkDirectory,
+  [int]$Commits = 2000,
+  [int]$Files = 1000,
+  [int]$FilesPerCommit = 5,
+  [int]$NewCommits = 10,
+  [ValidateSet("single", "multi")][string]$PackLayout = "single",
+  [ValidateSet("legacy", "cold", "warm", "relay")][string[]]$Scenarios = @("legacy", "cold", "warm", "relay"),
+  [int]$Iterations = 1,
+  [int]$Seed = 1,
+  [string]$OutputFile = ""
+)
+
+Set-StrictMode -Version 2.0
+$ErrorActionPreference = "Stop"
+
+function Invoke-Git([string[]]$Arguments) {
+  & git @Arguments
+  if ($LASTEXITCODE -ne 0) {
+    throw "git $($Arguments -join ' ') failed with exit code $LASTEXITCODE"
+  }
+}
+
+function Write-History([string]$GitDir, [int]$First, [int]$Last, [System.Random]$random) {
+  # Feeds commits $First..$Last of the synthetic history to git fast-import, which writes them
+  # as a single pack. Marks are the commit numbers, so later chunks can continue from earlier ones.
+  $stream = New-Object System.Text.StringBuilder
+  for ($commit = $First; $commit -le $Last; $commit++) {
+    $message = "Synthetic commit $commit"
+    [void]$stream.Append("commit refs/heads/main`nmark :$commit`n")
+    [void]$stream.Append("committer Mirror Benchmark <bench@example.com> $(1600000000 + $commit * 60) +0000`n")
+    [void]$stream.Append("data $($message.Length)`n$message`n")
+    if ($commit -gt 1) {
+      [void]$stream.Append("from :$($commit - 1)`n")
+    }
+    $paths = if ($commit -eq 1) { 0..($Files - 1) } else { 1..$FilesPerCommit | ForEach-Object { $random.Next($Files) } }
+    foreach ($path in $paths) {
+      $content = "file $path changed in commit $commit`n" + ("x" * $random.Next(64, 1024)) + "`n"
+      [void]$stream.Append("M 100644 inline src/dir$($path % 64)/file$path.txt`ndata $($content.Length)`n$content`n")
+    }
+  }
+  [void]$stream.Append("done`n")
+
+  $marks = Join-Path $WorkDirectory "marks"
+  $markArgs = @("--export-marks=$marks") + @(if ($First -gt 1) { "--import-marks=$marks" })
+  $streamFile = Join-Path $WorkDirectory "history.fi"
+  [System.IO.File]::WriteAllText($streamFile, $stream.ToString())
+  $process = Start-Process git -ArgumentList (@("--git-dir=$GitDir", "fast-import", "--quiet", "--done") + $markArgs) `
+    -RedirectStandardInput $streamFile -NoNewWindow -Wait -PassThru
+  if ($process.ExitCode -ne 0) {
+    throw "git fast-import failed with exit code $($process.ExitCode)"
+  }
+  Remove-Item $streamFile
+}
+
+function New-Repositories {
+  Write-Host "Generating $Commits commits over $Files files ($PackLayout pack layout)"
+  $random = New-Object System.Random $Seed
+  Invoke-Git @("init", "--bare", "--quiet", $sourceDir)
+  Invoke-Git @("--git-dir=$sourceDir", "config", "uploadpack.allowFilter", "true")
+  $chunks = if ($PackLayout -eq "multi") { 10 } else { 1 }
+  $chunkSize = [Math]::Ceiling($Commits / $chunks)
+  for ($first = 1; $first -le $Commits; $first += $chunkSize) {
+    Write-History $sourceDir $first ([Math]::Min($Commits, $first + $chunkSize - 1)) $random
+  }
+  if ($PackLayout -eq "single") {
+    Invoke-Git @("--git-dir=$sourceDir", "repack", "-adq")
+  }
+
+  Invoke-Git @("init", "--bare", "--quiet", $templateDir)
+  Invoke-Git @("--git-dir=$sourceDir", "push", "--quiet", $templateDir, "main~$($NewCommits):refs/heads/runtime-main")
+  Invoke-Git @("--git-dir=$templateDir", "repack", "-adq")
+}
+
+function Reset-Target {
+  if (Test-Path $targetDir) {
+    Remove-Item -Recurse -Force $targetDir
+  }
+  Copy-Item -Recurse $templateDir $targetDir
+}
+
+function Add-Result([string]$Scenario, [string]$Step, [double]$Seconds, $PeakRssKiB = $null, $ReadBytes = $null,
+                    $WrittenBytes = $null, $ReceivedBytes = $null, $SentBytes = $null) {
+  $results.Add([pscustomobject]@{
+    scenario = $Scenario
+    iteration = $iteration
+    step = $Step
+    seconds = [Math]::Round($Seconds, 3)
+    peakRssKiB = $PeakRssKiB
+    readBytes = $ReadBytes
+    writtenBytes = $WrittenBytes
+    receivedBytes = $ReceivedBytes
+    sentBytes = $SentBytes
+  })
+}
+
+function Measure-Step([string]$Scenario, [string]$Step, [string]$Directory, [string]$Command, [string[]]$Arguments) {
+  # GNU time reports the largest RSS of the command and every process it waited for, and the
+  # file system blocks (512 bytes each) read and written by all of them.
+  $stats = Join-Path $WorkDirectory "time.txt"
+  Push-Location $Directory
+  try {
+    $stopwatch = [System.Diagnostics.Stopwatch]::StartNew()
+    if ($useTime) {
+      & /usr/bin/time -f "%M %I %O" -o $stats $Command @Arguments | Out-Host
+    } else {
+      & $Command @Arguments | Out-Host
+    }
+    $exitCode = $LASTEXITCODE
+    $stopwatch.Stop()
+  } finally {
+    Pop-Location
+  }
+  if ($exitCode -ne 0) {
+    throw "$Scenario/$Step failed with exit code $exitCode"
+  }
+
+  if ($useTime) {
+    $rss, $read, $written = (Get-Content $stats | Select-Object -Last 1) -split ' '
+    Add-Result $Scenario $Step $stopwatch.Elapsed.TotalSeconds ([long]$rss) ([long]$read * 512) ([long]$written * 512)
+  } else {
+    Add-Result $Scenario $Step $stopwatch.Elapsed.TotalSeconds
+  }
+}
+
+function Invoke-Legacy {
+  $clone = Join-Path $WorkDirectory "legacy"
+  if (Test-Path $clone) {
+    Remove-Item -Recurse -Force $clone
+  }
+  Measure-Step "legacy" "clone" $WorkDirectory git @("clone", "--quiet", "--no-local", $targetDir, $clone, "-b", "runtime-main")
+  Invoke-Git @("-C", $clone, "remote", "add", "runtime", $sourceDir)
+  Measure-Step "legacy" "fetch" $clone git @("fetch", "--quiet", "runtime", "main")
+  Measure-Step "legacy" "reset" $clone git @("reset", "--quiet", "--hard", "runtime/main")
+  Measure-Step "legacy" "push" $clone git @("push", "--quiet", "origin", "runtime-main")
+  Measure-Step "legacy" "check-fetch" $clone git @("fetch", "--quiet", "--multiple", "origin", "runtime")
+  Measure-Step "legacy" "check-rev-list" $clone git @("rev-list", "--count", "runtime/main..origin/runtime-main")
+  Remove-Item -Recurse -Force $clone
+}
+
+function Invoke-Mirror([string]$Scenario, [string]$Cache, [string[]]$ExtraArguments = @()) {
+  $metricsFile = Join-Path $WorkDirectory "metrics-$Scenario.json"
+  if (Test-Path $metricsFile) {
+    Remove-Item $metricsFile
+  }
+  Measure-Step $Scenario "total (pwsh)" $WorkDirectory $pwsh (@("-NoProfile", "-File", $mirrorScript,
+    "-CacheDirectory", $Cache, "-SourceUrl", $sourceDir, "-TargetUrl", $targetDir,
+    "-MappingFile", $mappingFile, "-Filter", "blob:none", "-PushAttempts", "1",
+    "-MetricsFile", $metricsFile) + @(if ($useTime) { "-MeasureGit" }) + $ExtraArguments)
+
+  # mirror.ps1 measures its own stages; GNU time around pwsh cannot tell them apart.
+  $record = Get-Content $metricsFile | Select-Object -Last 1 | ConvertFrom-Json
+  foreach ($stage in $record.stages) {
+    $sent = if ($stage.name -eq "push") { $record.sent.bytes } else { 0 }
+    Add-Result $Scenario $stage.name $stage.seconds $stage.peakRssKiB $stage.readBytes $stage.writtenBytes `
+      -ReceivedBytes $stage.bytesReceived -SentBytes $sent
+  }
+}
+
+$WorkDirectory = (New-Item -ItemType Directory -Force $WorkDirectory).FullName
+$sourceDir = Join-Path $WorkDirectory "source.git"
+$templateDir = Join-Path $WorkDirectory "target-template.git"
+$targetDir = Join-Path $WorkDirectory "target.git"
+$mappingFile = Join-Path $WorkDirectory "mirror-branches.json"
+$mirrorScript = Join-Path $PSScriptRoot "mirror.ps1"
+$pwsh = (Get-Process -Id $PID).Path
+$useTime = $IsLinux -and (Test-Path /usr/bin/time)
+$results = New-Object System.Collections.Generic.List[object]
+
+foreach ($dir in @($sourceDir, $templateDir, $targetDir)) {
+  if (Test-Path $dir) {
+    Remove-Item -Recurse -Force $dir
+  }
+}
+New-Repositories
+Set-Content -Path $mappingFile -Value '{ "branches": [ { "source": "main", "target": "runtime-main" } ] }'
+$tip = (& git --git-dir=$sourceDir rev-parse main)
+
+for ($iteration = 1; $iteration -le $Iterations; $iteration++) {
+  if ($Scenarios -contains "legacy") {
+    Reset-Target
+    Invoke-Legacy
+  }
+  if ($Scenarios -contains "cold") {
+    Reset-Target
+    $cache = Join-Path $WorkDirectory "cache-cold.git"
+    if (Test-Path $cache) {
+      Remove-Item -Recurse -Force $cache
+    }
+    Invoke-Mirror "cold" $cache
+  }
+  if ($Scenarios -contains "warm") {
+    # Warm the cache with upstream still at the target's commit, then land the new commits.
+    Reset-Target
+    $cache = Join-Path $WorkDirectory "cache-warm.git"
+    if (Test-Path $cache) {
+      Remove-Item -Recurse -Force $cache
+    }
+    Invoke-Git @("--git-dir=$sourceDir", "update-ref", "refs/heads/main", "$tip~$NewCommits")
+    & $pwsh -NoProfile -File $mirrorScript -CacheDirectory $cache -SourceUrl $sourceDir -TargetUrl $targetDir `
+      -MappingFile $mappingFile -Filter blob:none -PushAttempts 1 | Out-Null
+    if ($LASTEXITCODE -ne 0) {
+      throw "warm/warm-up failed with exit code $LASTEXITCODE"
+    }
+    Invoke-Git @("--git-dir=$sourceDir", "update-ref", "refs/heads/main", $tip)
+    Invoke-Mirror "warm" $cache
+  }
+  if ($Scenarios -contains "relay") {
+    Reset-Target
+    Invoke-Mirror "relay" (Join-Path $WorkDirectory "relay.git") @("-Relay")
+  }
+}
+
+$results | Format-Table -AutoSize | Out-Host
+if ($OutputFile) {
+  $results | ConvertTo-Json -Depth 3 | Set-Content -Path $OutputFile
+}
@@ -0,0 +1,132 @@
+<#
+.SYNOPSIS
+Runs eng/mirror.ps1 whenever upstream moves, coalescing bursts of notifications.
+
+.DESCRIPTION
+Watches -NotificationFile, to which some other process appends one line per "upstream moved"
+notification (the content of the line is only logged). A sync starts once no notification has
+arrived for -SettleSeconds, or -MaxDelaySeconds after the first pending one if they keep
+coming, and mirrors whatever the upstream tips are at that point. A burst of pushes therefore
+costs a single sync of the latest tip.
+
+Syncs run one at a time in this process. Notifications that arrive during a sync are picked up
+once it finishes and lead to at most one more sync. A lock on <CacheDirectory>.lock keeps a
+second watcher from using the same cache. A failed sync is logged and retried on the next
+notification.
+
+  ./eng/mirror-watch.ps1 -NotificationFile events.txt -CacheDirectory cache.git -SourceUrl runtime.git -TargetUrl runtimelab.git
+  Add-Content events.txt "main moved"
+
+With -IdleExitSeconds the watcher exits after that long without notifications or pending work,
+for example to try it out against local bare repositories.
+#>
+[CmdletBinding(PositionalBinding=$false)]
+Param(
+  [Parameter(Mandatory=$true)][string]$NotificationFile,
+  [Parameter(Mandatory=$true)][string]$CacheDirectory,
+  [Parameter(Mandatory=$true)][string]$SourceUrl,
+  [Parameter(Mandatory=$true)][string]$TargetUrl,
+  [string]$SourceRemote = "runtime",
+  [string]$MappingFile = (Join-Path $PSScriptRoot "mirror-branches.json"),
+  [string]$Filter = "",
+  [string]$MetricsFile = "",
+  [double]$SettleSeconds = 2,
+  [double]$MaxDelaySeconds = 30,
+  [int]$PollMilliseconds = 250,
+  [double]$IdleExitSeconds = 0
+)
+
+Set-StrictMode -Version 2.0
+$ErrorActionPreference = "Stop"
+
+function Read-Notifications {
+  # Returns the complete lines appended since the last call. A partial last line is left for
+  # the next call; a file that shrank was truncated and is read again from the start.
+  if (-not (Test-Path $NotificationFile)) {
+    return @()
+  }
+  $stream = [System.IO.File]::Open($NotificationFile, "Open", "Read", "ReadWrite, Delete")
+  try {
+    if ($stream.Length -lt $script:offset) {
+      $script:offset = 0
+    }
+    if ($stream.Length -eq $script:offset) {
+      return @()
+    }
+    [void]$stream.Seek($script:offset, "Begin")
+    $bytes = New-Object byte[] ($stream.Length - $script:offset)
+    $read = $stream.Read($bytes, 0, $bytes.Length)
+  } finally {
+    $stream.Dispose()
+  }
+  $end = [Array]::LastIndexOf($bytes, [byte]10, $read - 1)
+  if ($end -lt 0) {
+    return @()
+  }
+  $script:offset += $end + 1
+  $text = [System.Text.Encoding]::UTF8.GetString($bytes, 0, $end)
+  return @($text -split "\r?\n")
+}
+
+function Invoke-Sync([int]$Notifications) {
+  Write-Host "Syncing after $Notifications notification(s)"
+  $mirrorArgs = @{
+    CacheDirectory = $CacheDirectory
+    SourceUrl = $SourceUrl
+    TargetUrl = $TargetUrl
+    SourceRemote = $SourceRemote
+    MappingFile = $MappingFile
+    Filter = $Filter
+    MetricsFile = $MetricsFile
+  }
+  try {
+    # mirror.ps1 ends with exit, which only leaves that script and sets $LASTEXITCODE.
+    & (Join-Path $PSScriptRoot "mirror.ps1") @mirrorArgs
+    if ($LASTEXITCODE -ne 0) {
+      Write-Host "##vso[task.LogIssue type=warning;]Mirror sync failed with exit code $LASTEXITCODE"
+    }
+  } catch {
+    Write-Host "##vso[task.LogIssue type=warning;]Mirror sync failed: $_"
+  }
+}
+
+$lockPath = "$([System.IO.Path]::GetFullPath($CacheDirectory).TrimEnd('/', '\')).lock"
+try {
+  $lock = [System.IO.File]::Open($lockPath, "OpenOrCreate", "ReadWrite", "None")
+} catch [System.IO.IOException] {
+  throw "Another mirror watcher holds $lockPath"
+}
+
+try {
+  # Only notifications written after the watcher starts count.
+  $offset = if (Test-Path $NotificationFile) { (Get-Item $NotificationFile).Length } else { 0 }
+  $pending = 0
+  $firstPending = $null
+  $lastActivity = [DateTime]::UtcNow
+
+  while ($true) {
+    $now = [DateTime]::UtcNow
+    foreach ($line in Read-Notifications) {
+      Write-Host "Notification: $line"
+      if ($pending -eq 0) {
+        $firstPending = $now
+      }
+      $pending++
+      $lastActivity = $now
+    }
+
+    if ($pending -ne 0 -and
+        (($now - $lastActivity).TotalSeconds -ge $SettleSeconds -or ($now - $firstPending).TotalSeconds -ge $MaxDelaySeconds)) {
+      Invoke-Sync $pending
+      $pending = 0
+      $lastActivity = [DateTime]::UtcNow
+    } elseif ($pending -eq 0 -and $IdleExitSeconds -gt 0 -and ($now - $lastActivity).TotalSeconds -ge $IdleExitSeconds) {
+      Write-Host "No notifications for $IdleExitSeconds seconds, exiting"
+      break
+    }
+
+    Start-Sleep -Milliseconds $PollMilliseconds
+  }
+} finally {
+  $lock.Dispose()
+}
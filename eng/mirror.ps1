@@ -0,0 +1,445 @@
+<#
+.SYNOPSIS
+Mirrors dotnet/runtime branches into dotnet/runtimelab branches.
+
+.DESCRIPTION
+All git state lives in a bare repository at -CacheDirectory. It is created on the first
+run and reused afterwards, so a run only transfers the objects that are new on either
+remote since the cache was last saved. There is no working tree: target branches are
+moved by pushing the fetched source refs straight to them (runtime/main:refs/heads/runtime-main),
+so nothing in the dotnet/runtime tree is ever checked out.
+
+The branches to mirror come from -MappingFile, a JSON file listing source to target pairs:
+
+  { "branches": [ { "source": "main", "target": "runtime-main" },
+                  { "source": "release/*", "target": "runtime-release/*" } ] }
+
+A pattern may contain a single '*' on both sides, with the same meaning as in a git refspec.
+All mapped branches are fetched from each remote in a single negotiation and pushed in a
+single atomic push, so adding branches adds almost nothing to the cost of a run. Target
+branches named without a pattern must already exist in the target repository.
+
+With -Filter (e.g. blob:none) the source is fetched as a partial clone. A cold cache then
+only downloads commits and trees; the blobs the push actually needs are fetched on demand
+in one batch from the source remote. The target is fetched after the source so that its
+history, which is normally an ancestor of the source branch, is already present.
+
+Each target branch is pushed with --force-with-lease against the value it had when it was
+fetched, after checking locally that this value is an ancestor of the source. A concurrent
+update of a target branch therefore shows up as a "stale info" rejection of that ref: the
+script then refreshes both remotes incrementally and checks again, so commits pushed to
+runtimelab in the meantime are reported instead of overwritten. Other failures are retried
+as they are. Retries wait with jittered exponential backoff (-RetryBaseSeconds doubling up
+to -RetryMaxSeconds) for at most -PushAttempts pushes in total.
+
+With -Relay the script does not keep a cache: -CacheDirectory is a scratch repository that
+is created for the run and deleted afterwards. Instead of fetching the history of the target
+branches, it asks the target for their tips (ls-remote) and fetches just those commits and
+their trees from the source with a depth of one. The source fetch then negotiates against
+these tips and receives only the new commits, and the push leaves out everything reachable
+from them, so disk and memory use are bounded by the tip trees and the delta being relayed
+rather than by the size of the history. Use it together with -Filter blob:none so that the
+tips come without blobs; the blobs of the new commits are fetched in one batch by the push.
+A target tip that the source does not have means runtimelab has diverged and fails the run;
+other failures of that fetch are retried with the same backoff as the push.
+
+Right after the fetches the cache gets a new commit-graph layer and a rewritten
+multi-pack-index bitmap, which the divergence check (merge-base --is-ancestor) and the push
+object counting of the same run then use, as do the fetches of later runs that restore the
+saved cache. The commit-graph layer only holds the commits fetched by the run, but the bitmap
+is rebuilt over the whole repository, so this stage grows with the history, not the delta.
+
+Every run ends by printing one JSON metrics record, also appended to -MetricsFile if given.
+It holds the duration of each stage (fetch-source, fetch-target, maintenance, then check
+and push, repeated on retries) with the objects, bytes and packs it received, the objects and
+bytes sent by the successful push, and for each mirrored branch the lag between the
+upstream commit time of its tip and the end of the push. With -MeasureGit (Linux, needs
+GNU time at /usr/bin/time) each stage also records the peak RSS of its git commands and the
+bytes they read from and wrote to disk.
+
+The remotes are passed as URLs on every run and are never written to the cache config,
+so credentials embedded in -TargetUrl do not end up in the saved cache. The source URL is
+stored as the partial clone promisor remote and should not carry credentials. Plain paths to
+local bare repositories work too, which is how the script can be exercised without GitHub:
+
+  git init --bare runtime.git; git init --bare runtimelab.git
+  ./eng/mirror.ps1 -CacheDirectory cache.git -SourceUrl runtime.git -TargetUrl runtimelab.git
+#>
+[CmdletBinding(PositionalBinding=$false)]
+Param(
+  [Parameter(Mandatory=$true)][string]$CacheDirectory,
+  [Parameter(Mandatory=$true)][string]$SourceUrl,
+  [Parameter(Mandatory=$true)][string]$TargetUrl,
+  [string]$SourceRemote = "runtime",
+  [string]$MappingFile = (Join-Path $PSScriptRoot "mirror-branches.json"),
+  [string]$Filter = "",
+  [string]$ExtraPushArgs = "",
+  [int]$PushAttempts = 5,
+  [double]$RetryBaseSeconds = 2,
+  [double]$RetryMaxSeconds = 60,
+  [string]$MetricsFile = "",
+  [switch]$Relay,
+  [switch]$MeasureGit
+)
+
+Set-StrictMode -Version 2.0
+$ErrorActionPreference = "Stop"
+
+function Invoke-Git([string[]]$Arguments, [switch]$AllowFailure) {
+  if ($gitTimeFile) {
+    # GNU time exits with the status of git, and its -o record covers every process git waits for.
+    & /usr/bin/time -a -o $gitTimeFile -f "%M %I %O" git --git-dir=$CacheDirectory @Arguments
+  } else {
+    & git --git-dir=$CacheDirectory @Arguments
+  }
+  if ($LASTEXITCODE -ne 0 -and -not $AllowFailure) {
+    throw "git $($Arguments -join ' ') failed with exit code $LASTEXITCODE"
+  }
+}
+
+function Read-Mappings {
+  $mappings = @((Get-Content -Raw $MappingFile | ConvertFrom-Json).branches)
+  if ($mappings.Count -eq 0) {
+    throw "$MappingFile does not map any branches"
+  }
+  foreach ($mapping in $mappings) {
+    $sourceStars = $mapping.source.Split('*').Count - 1
+    $targetStars = $mapping.target.Split('*').Count - 1
+    if ($sourceStars -gt 1 -or $sourceStars -ne $targetStars) {
+      throw "Invalid mapping '$($mapping.source)' -> '$($mapping.target)': both sides need the same single '*' or none"
+    }
+  }
+  return $mappings
+}
+
+function Get-PackState {
+  $packs = @{}
+  foreach ($pack in @(Get-ChildItem -Path (Join-Path $CacheDirectory "objects/pack") -Filter "*.pack" -ErrorAction SilentlyContinue)) {
+    $packs[$pack.Name] = $pack.Length
+  }
+  $inPack = [long]((Invoke-Git @("count-objects", "-v") | Where-Object { $_ -like "in-pack:*" }) -split ':\s*')[1]
+  return [pscustomobject]@{ Packs = $packs; Objects = $inPack }
+}
+
+function Invoke-Stage([string]$Name, [scriptblock]$Action, [switch]$Local) {
+  # Runs one stage of the mirror and records its duration and what it received. Fetches keep
+  # every received pack as is (fetch.unpackLimit=1) and never repack in the background
+  # (--no-auto-gc), so the packs that appear during the stage are exactly what was received.
+  # -Local marks stages that only rewrite packs already in the cache and receive nothing.
+  $before = Get-PackState
+  if ($MeasureGit) {
+    $script:gitTimeFile = Join-Path ([System.IO.Path]::GetTempPath()) "mirror-git-time-$PID.txt"
+    Remove-Item $gitTimeFile -ErrorAction SilentlyContinue
+  }
+  $stopwatch = [System.Diagnostics.Stopwatch]::StartNew()
+  try {
+    & $Action
+  } finally {
+    $stopwatch.Stop()
+    $usage = Get-GitUsage
+    $after = Get-PackState
+    $newPacks = @($after.Packs.Keys | Where-Object { -not $Local -and -not $before.Packs.ContainsKey($_) })
+    $metrics.stages += [pscustomobject]@{
+      name = $Name
+      seconds = [Math]::Round($stopwatch.Elapsed.TotalSeconds, 3)
+      objectsReceived = if ($Local) { 0 } else { [Math]::Max(0, $after.Objects - $before.Objects) }
+      bytesReceived = [long](($newPacks | ForEach-Object { $after.Packs[$_] } | Measure-Object -Sum).Sum)
+      packsReceived = $newPacks.Count
+      peakRssKiB = $usage.PeakRssKiB
+      readBytes = $usage.ReadBytes
+      writtenBytes = $usage.WrittenBytes
+    }
+  }
+}
+
+function Get-GitUsage {
+  # With -MeasureGit, sums up the GNU time records of the git commands run by a stage: the
+  # largest RSS of any of them and their file system blocks (512 bytes each) read and written.
+  $usage = [pscustomobject]@{ PeakRssKiB = $null; ReadBytes = $null; WrittenBytes = $null }
+  if (-not $gitTimeFile) {
+    return $usage
+  }
+  $usage.PeakRssKiB = 0; $usage.ReadBytes = 0; $usage.WrittenBytes = 0
+  if (Test-Path $gitTimeFile) {
+    # Failed commands add a "Command exited with non-zero status" line before their record.
+    foreach ($line in @(Get-Content $gitTimeFile | Where-Object { $_ -match '^\d+ \d+ \d+$' })) {
+      $rss, $read, $written = $line -split ' '
+      $usage.PeakRssKiB = [Math]::Max($usage.PeakRssKiB, [long]$rss)
+      $usage.ReadBytes += [long]$read * 512
+      $usage.WrittenBytes += [long]$written * 512
+    }
+    Remove-Item $gitTimeFile
+  }
+  $script:gitTimeFile = ""
+  return $usage
+}
+
+function Sync-Remotes {
+  $sourceRefspecs = @($mappings | ForEach-Object { "+refs/heads/$($_.source):refs/remotes/$SourceRemote/$($_.source)" })
+  $targetRefspecs = @($mappings | ForEach-Object { "+refs/heads/$($_.target):refs/remotes/origin/$($_.target)" })
+  if ($Relay) {
+    $script:tipsDiverged = $false
+    Invoke-Stage "fetch-target" { Sync-TargetTips }
+    if ($tipsDiverged) {
+      Exit-Mirror "diverged" 1
+    }
+    Invoke-Stage "fetch-source" { Invoke-Git (@("fetch", "--no-tags", "--no-auto-gc", "--prune") + $filterArgs + @($SourceRemote) + $sourceRefspecs) }
+    return
+  }
+  # The cache outlives branches: --prune drops remote-tracking refs of branches deleted on
+  # either side, so they are neither pushed again nor leased against a value that is gone.
+  Invoke-Stage "fetch-source" { Invoke-Git (@("fetch", "--no-tags", "--no-auto-gc", "--prune") + $filterArgs + @($SourceRemote) + $sourceRefspecs) }
+  Invoke-Stage "fetch-target" { Invoke-Git (@("fetch", "--no-tags", "--no-auto-gc", "--prune", $TargetUrl) + $targetRefspecs) }
+}
+
+function Sync-TargetTips {
+  # Relay mode: records the target branch tips as origin remote-tracking refs and fetches only
+  # their commits and trees, from the source, which normally has them already.
+  $patterns = @($mappings | ForEach-Object { "refs/heads/$($_.target)" })
+  $tips = @(Invoke-Git (@("ls-remote", $TargetUrl) + $patterns) | ForEach-Object {
+    $oid, $ref = $_ -split "\t", 2
+    [pscustomobject]@{ Oid = $oid; Ref = "refs/remotes/origin/" + $ref.Substring("refs/heads/".Length) }
+  })
+  # Tips recorded by an earlier attempt of this run may belong to branches deleted since.
+  foreach ($ref in @(Invoke-Git @("for-each-ref", "--format=%(refname)", "refs/remotes/origin/"))) {
+    Invoke-Git @("update-ref", "-d", $ref)
+  }
+  if ($tips.Count -eq 0) {
+    return
+  }
+  $fetchArgs = @("fetch", "--no-tags", "--no-auto-gc", "--depth=1") + $filterArgs + @($SourceRemote) + @($tips | ForEach-Object { $_.Oid })
+  # Only a tip the source does not have means divergence; upload-pack then refuses the want
+  # with "not our ref". Anything else, such as a dropped connection, is retried with backoff.
+  $ErrorActionPreference = "Continue"
+  for ($attempt = 1; ; $attempt++) {
+    $output = @(Invoke-Git -AllowFailure $fetchArgs 2>&1 | ForEach-Object { ("$_" -split "`r")[-1] })
+    $exitCode = $LASTEXITCODE
+    $output | Out-Host
+    if ($exitCode -eq 0) {
+      break
+    }
+    if ($output -match "not our ref|no such remote ref|unadvertised object") {
+      # Reported by the caller through Exit-Mirror, once this stage has been recorded.
+      Write-Host "##vso[task.LogIssue type=error;]Mirror repository runtimelab has commits that are not in $SourceUrl"
+      $script:tipsDiverged = $true
+      return
+    }
+    if ($attempt -ge $PushAttempts) {
+      throw "git fetch of the target tips failed with exit code $exitCode"
+    }
+    $delay = Get-RetryDelay $attempt
+    Write-Host ("##vso[task.LogIssue type=warning;]Fetching the target tips failed, retry {0} of {1} in {2:N1} seconds..." -f $attempt, ($PushAttempts - 1), $delay)
+    Start-Sleep -Milliseconds ([int]($delay * 1000))
+  }
+  foreach ($tip in $tips) {
+    Invoke-Git @("update-ref", $tip.Ref, $tip.Oid)
+  }
+}
+
+function Update-CacheIndexes {
+  # Fetches skip automatic gc so that it does not skew the stage metrics; it runs here instead,
+  # and only repacks once enough packs have piled up. The commit-graph gets a new split layer
+  # holding just the commits fetched by this run, which gives the divergence check and fetch
+  # negotiation generation numbers to stop their walks early. The multi-pack-index bitmap lets
+  # the push count reachable objects without walking trees; unlike the commit-graph it is
+  # written from scratch over every reachable object, so its cost follows the repository size.
+  Invoke-Git @("gc", "--auto")
+  Invoke-Git @("commit-graph", "write", "--reachable", "--split")
+  Invoke-Git @("multi-pack-index", "write", "--bitmap")
+}
+
+function Get-MirroredRefs {
+  # Expands the mappings into concrete (source, target) remote-tracking ref pairs.
+  foreach ($mapping in $mappings) {
+    $sourcePrefix, $sourceSuffix = "refs/remotes/$SourceRemote/$($mapping.source)" -split '\*', 2
+    $targetPrefix, $targetSuffix = "refs/remotes/origin/$($mapping.target)" -split '\*', 2
+    # A '*' in a refspec may span several path components, so list everything under the
+    # last directory before it and filter here.
+    $pattern = if ($null -eq $sourceSuffix) { $sourcePrefix } else { $sourcePrefix.Substring(0, $sourcePrefix.LastIndexOf('/') + 1) }
+    foreach ($sourceRef in @(Invoke-Git @("for-each-ref", "--format=%(refname)", $pattern))) {
+      if ($null -eq $sourceSuffix) {
+        $targetRef = $targetPrefix
+      } elseif ($sourceRef.StartsWith($sourcePrefix) -and $sourceRef.EndsWith($sourceSuffix) -and
+                $sourceRef.Length -gt $sourcePrefix.Length + $sourceSuffix.Length) {
+        $match = $sourceRef.Substring($sourcePrefix.Length, $sourceRef.Length - $sourcePrefix.Length - $sourceSuffix.Length)
+        $targetRef = "$targetPrefix$match$targetSuffix"
+      } else {
+        continue
+      }
+      $observed = Invoke-Git -AllowFailure @("rev-parse", "--quiet", "--verify", $targetRef)
+      [pscustomobject]@{
+        Source = $sourceRef
+        Target = $targetRef
+        Branch = "refs/heads/" + $targetRef.Substring("refs/remotes/origin/".Length)
+        # The value the target branch had when it was fetched, or empty if it did not exist.
+        Observed = if ($LASTEXITCODE -eq 0) { $observed } else { "" }
+      }
+    }
+  }
+}
+
+function Test-Diverged($pairs) {
+  # Every push below is a forced update guarded by a lease, so it must never be allowed
+  # to drop commits that runtimelab has and the source does not.
+  $diverged = $false
+  foreach ($pair in $pairs) {
+    if (-not $pair.Observed) {
+      continue
+    }
+    Invoke-Git -AllowFailure @("merge-base", "--is-ancestor", $pair.Target, $pair.Source)
+    if ($LASTEXITCODE -eq 1) {
+      Write-Host "##vso[task.LogIssue type=error;]Mirror repository runtimelab has unexpected commits on $($pair.Branch)"
+      Invoke-Git @("--no-pager", "log", "$($pair.Source)..$($pair.Target)") | Out-Host
+      $diverged = $true
+    } elseif ($LASTEXITCODE -ne 0) {
+      throw "git merge-base failed with exit code $LASTEXITCODE"
+    }
+  }
+  return $diverged
+}
+
+function Push-Mirror($pairs) {
+  # --force-with-lease makes the push fail with "stale info" for any branch that moved after
+  # it was fetched, which is how a concurrent update is told apart from a transient failure.
+  $pushRefspecs = @($pairs | ForEach-Object { "$($_.Source):$($_.Branch)" })
+  $leaseArgs = @($pairs | ForEach-Object { "--force-with-lease=$($_.Branch):$($_.Observed)" })
+  # --progress makes git report the size of the pack it sends, even though stderr is not a
+  # terminal. Progress updates are separated by carriage returns; only the last one is kept.
+  $ErrorActionPreference = "Continue"
+  $output = @(Invoke-Git -AllowFailure (@("push", "--atomic", "--porcelain", "--progress") + $leaseArgs + @($TargetUrl) + $pushRefspecs + $pushArgs) 2>&1 |
+    ForEach-Object { ("$_" -split "`r")[-1] })
+  $succeeded = $LASTEXITCODE -eq 0
+  $output | Out-Host
+
+  # "Writing objects: 100% (9/9), 604 bytes | 604.00 KiB/s, done."
+  $written = $output | Where-Object { $_ -like "Writing objects: 100%*" } | Select-Object -Last 1
+  if ($succeeded -and $written -match "^Writing objects: 100% \((\d+)/\d+\), ([\d.]+) (bytes|KiB|MiB|GiB)") {
+    $unit = @{ "bytes" = 1; "KiB" = 1KB; "MiB" = 1MB; "GiB" = 1GB }[$Matches[3]]
+    $metrics.sent.objects += [long]$Matches[1]
+    $metrics.sent.bytes += [long]([double]$Matches[2] * $unit)
+    $metrics.sent.packs += 1
+  }
+
+  # Porcelain status lines look like "!<TAB>src:dst<TAB>[rejected] (stale info)".
+  $stale = @($output | Where-Object { $_ -match "^!\t[^\t]*:([^\t]*)\t.*\(stale info\)" } | ForEach-Object { $Matches[1] })
+  return [pscustomobject]@{ Succeeded = $succeeded; Stale = $stale }
+}
+
+function Get-RetryDelay([int]$attempt) {
+  # Exponential backoff with equal jitter, so concurrent runs do not retry in lockstep.
+  $delay = [Math]::Min($RetryMaxSeconds, $RetryBaseSeconds * [Math]::Pow(2, $attempt - 1))
+  if ($delay -le 0) {
+    return 0
+  }
+  return $delay / 2 + (Get-Random -Minimum 0.0 -Maximum ($delay / 2))
+}
+
+function Exit-Mirror([string]$Result, [int]$ExitCode = 0) {
+  $metrics.result = $Result
+  $metrics.seconds = [Math]::Round($runStopwatch.Elapsed.TotalSeconds, 3)
+  if ($Result -eq "succeeded") {
+    # Mirror lag is how long after a commit landed upstream it reached runtimelab.
+    $pushed = [DateTimeOffset]::UtcNow.ToUnixTimeSeconds()
+    foreach ($pair in $pairs) {
+      $committed = [long](Invoke-Git @("log", "-1", "--format=%ct", $pair.Source))
+      $metrics.branches += [pscustomobject]@{
+        branch = $pair.Branch
+        commit = Invoke-Git @("rev-parse", $pair.Source)
+        lagSeconds = $pushed - $committed
+      }
+    }
+  }
+
+  $record = $metrics | ConvertTo-Json -Compress -Depth 4
+  Write-Host "Mirror metrics: $record"
+  if ($MetricsFile) {
+    Add-Content -Path $MetricsFile -Value $record
+  }
+  if ($Relay -and (Test-Path $CacheDirectory)) {
+    Remove-Item -Recurse -Force $CacheDirectory
+  }
+  exit $ExitCode
+}
+
+$runStopwatch = [System.Diagnostics.Stopwatch]::StartNew()
+$metrics = [pscustomobject]@{
+  timestamp = [DateTimeOffset]::UtcNow.ToString("o")
+  result = ""
+  seconds = 0
+  attempts = 0
+  stages = @()
+  sent = [pscustomobject]@{ objects = 0; bytes = 0; packs = 0 }
+  branches = @()
+}
+$pairs = @()
+$gitTimeFile = ""
+
+# Any failure still ends in Exit-Mirror, so every run leaves a metrics record.
+try {
+  $mappings = Read-Mappings
+  $pushArgs = @($ExtraPushArgs -split '\s+' | Where-Object { $_ })
+  $filterArgs = @(if ($Filter) { "--filter=$Filter" })
+
+  if ($Relay -and (Test-Path $CacheDirectory)) {
+    Remove-Item -Recurse -Force $CacheDirectory
+  }
+  if (-not (Test-Path (Join-Path $CacheDirectory "HEAD"))) {
+    Write-Host "Initializing mirror cache in $CacheDirectory"
+    & git init --bare --quiet $CacheDirectory
+    if ($LASTEXITCODE -ne 0) {
+      throw "Failed to initialize mirror cache in $CacheDirectory"
+    }
+  }
+
+  # Only the source is a named remote, since it has to be reachable later to fetch missing
+  # blobs of a partial clone.
+  Invoke-Git @("config", "remote.$SourceRemote.url", $SourceUrl)
+  Invoke-Git @("config", "fetch.unpackLimit", "1")
+
+  Sync-Remotes
+  # The weekly cache key means most runs restore the cache without saving it again, so the
+  # indexes are built before the check and push of this run rather than after them.
+  if (-not $Relay) {
+    Invoke-Stage "maintenance" { Update-CacheIndexes } -Local
+  }
+
+  for ($attempt = 1; ; $attempt++) {
+    $pairs = @(Get-MirroredRefs)
+    if ($pairs.Count -eq 0) {
+      Write-Host "No mapped branches exist in $SourceUrl"
+      Exit-Mirror "nothing-to-mirror"
+    }
+    if (Invoke-Stage "check" { Test-Diverged $pairs }) {
+      Exit-Mirror "diverged" 1
+    }
+
+    $metrics.attempts = $attempt
+    $result = Invoke-Stage "push" { Push-Mirror $pairs }
+    if ($result.Succeeded) {
+      Write-Host "Push was successful"
+      Exit-Mirror "succeeded"
+    }
+    if ($attempt -ge $PushAttempts) {
+      break
+    }
+
+    if ($result.Stale.Count -ne 0) {
+      # Someone else moved a target branch after it was fetched. Both remotes are already
+      # in the cache, so refreshing them only costs the objects that arrived since then.
+      Write-Host "Target branches moved since they were fetched: $($result.Stale -join ', ')"
+      Sync-Remotes
+    } else {
+      Write-Host "##vso[task.LogIssue type=warning;]Push failed for unknown reason"
+    }
+
+    $delay = Get-RetryDelay $attempt
+    Write-Host ("Retry attempt {0} of {1} in {2:N1} seconds..." -f $attempt, ($PushAttempts - 1), $delay)
+    Start-Sleep -Milliseconds ([int]($delay * 1000))
+  }
+
+  Write-Host "##vso[task.LogIssue type=error;]git failed to push to Azure DevOps mirror"
+  Exit-Mirror "failed" 1
+} catch {
+  Write-Host "##vso[task.LogIssue type=error;]Mirror failed: $_"
+  Exit-Mirror "error" 1
+}